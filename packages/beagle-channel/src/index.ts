@@ -1,4 +1,4 @@
-import { createSidecarClient, type BeagleAccount } from "./sidecarClient.js";
+import { createSidecarClient, SidecarRequestError, type BeagleAccount } from "./sidecarClient.js";
 
 // OpenClaw plugin entrypoint. Types are intentionally loose to avoid
 // coupling to a specific SDK version.
@@ -17,7 +17,8 @@ export default function register(api: any) {
     },
     capabilities: {
       chatTypes: ["direct"],
-      media: true
+      media: true,
+      streaming: true
     },
     config: {
       listAccountIds: (cfg: any) => Object.keys(cfg?.channels?.beagle?.accounts ?? {}),
@@ -31,6 +32,36 @@ export default function register(api: any) {
         await client.sendText({ peer: chatId, text });
         return { ok: true };
       },
+      // Incremental replies: `chunks` yields text as the agent produces it.
+      // The sidecar coalesces chunks into a few messages, so the peer sees
+      // the start of the answer long before the agent finishes.
+      sendTextStream: async ({ cfg, accountId, chatId, chunks }: any) => {
+        const account = resolveAccount(cfg, accountId);
+        const client = createSidecarClient(account);
+        let streamId: string | undefined;
+        const append = async (text: string, final: boolean) => {
+          try {
+            const res = await client.sendStream({ streamId, peer: chatId, text, final });
+            streamId = res.streamId;
+            if (res.delivered === false) {
+              api?.logger?.warn?.({ streamId }, "beagle stream delivery pending; sidecar is retrying");
+            }
+          } catch (err) {
+            // The sidecar closes streams left idle (e.g. during a long tool
+            // call) after flushing them; continue the reply in a new stream.
+            if (!(err instanceof SidecarRequestError && err.status === 404 && streamId)) throw err;
+            streamId = undefined;
+            if (!text) return;
+            const res = await client.sendStream({ peer: chatId, text, final });
+            streamId = res.streamId;
+          }
+        };
+        for await (const chunk of chunks as AsyncIterable<string>) {
+          if (chunk) await append(chunk, false);
+        }
+        if (streamId) await append("", true);
+        return { ok: true };
+      },
       sendMedia: async ({ cfg, accountId, chatId, caption, mediaPath, mediaUrl, mediaType, filename }: any) => {
         const account = resolveAccount(cfg, accountId);
         const client = createSidecarClient(account);
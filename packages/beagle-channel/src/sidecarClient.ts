@@ -3,9 +3,16 @@ export type BeagleAccount = {
   enabled?: boolean;
   sidecarBaseUrl: string;
   authToken?: string;
+  // Consumer group used for `/events`; replicas sharing a group split the
+  // inbound load, separate groups each see every event.
+  consumerGroup?: string;
+  consumerId?: string;
+  // Where a newly created consumer group starts reading.
+  consumerStart?: "earliest" | "latest";
 };
 
 export type SidecarEvent = {
+  seq?: number;
   peer: string;
   text?: string;
   mediaUrl?: string;
@@ -22,6 +29,32 @@ export type SendTextRequest = {
   text: string;
 };
 
+export type SendStreamRequest = {
+  // Omit on the first chunk; the sidecar opens a stream and returns its id.
+  streamId?: string;
+  peer?: string;
+  text: string;
+  final?: boolean;
+};
+
+export type SendStreamResponse = {
+  ok: boolean;
+  streamId: string;
+  // False while the sidecar is still retrying earlier text of this stream;
+  // the chunk itself was accepted.
+  delivered?: boolean;
+};
+
+export class SidecarRequestError extends Error {
+  constructor(
+    message: string,
+    readonly status: number
+  ) {
+    super(message);
+    this.name = "SidecarRequestError";
+  }
+}
+
 export type SendMediaRequest = {
   peer: string;
   caption?: string;
@@ -33,11 +66,14 @@ export type SendMediaRequest = {
 
 export type SidecarClient = {
   sendText(req: SendTextRequest): Promise<void>;
+  sendStream(req: SendStreamRequest): Promise<SendStreamResponse>;
   sendMedia(req: SendMediaRequest): Promise<void>;
   pollEvents(signal: AbortSignal): Promise<SidecarEvent[]>;
 };
 
 export function createSidecarClient(account: BeagleAccount): SidecarClient {
+  const consumerId = account.consumerId ?? globalThis.crypto.randomUUID();
+
   async function request<T>(path: string, init?: RequestInit): Promise<T> {
     const headers: Record<string, string> = {
       "content-type": "application/json"
@@ -51,7 +87,7 @@ export function createSidecarClient(account: BeagleAccount): SidecarClient {
 
     if (!res.ok) {
       const body = await res.text().catch(() => "");
-      throw new Error(`sidecar ${path} failed: ${res.status} ${body}`);
+      throw new SidecarRequestError(`sidecar ${path} failed: ${res.status} ${body}`, res.status);
     }
 
     if (res.status === 204) return undefined as T;
@@ -65,6 +101,12 @@ export function createSidecarClient(account: BeagleAccount): SidecarClient {
         body: JSON.stringify(req)
       });
     },
+    async sendStream(req) {
+      return request<SendStreamResponse>("/sendStream", {
+        method: "POST",
+        body: JSON.stringify(req)
+      });
+    },
     async sendMedia(req) {
       await request("/sendMedia", {
         method: "POST",
@@ -72,7 +114,12 @@ export function createSidecarClient(account: BeagleAccount): SidecarClient {
       });
     },
     async pollEvents(signal) {
-      return request<SidecarEvent[]>("/events", {
+      const query = new URLSearchParams({
+        group: account.consumerGroup ?? "default",
+        member: consumerId
+      });
+      if (account.consumerStart) query.set("from", account.consumerStart);
+      return request<SidecarEvent[]>(`/events?${query}`, {
         method: "GET",
         signal
       });
@@ -37,6 +37,12 @@ bool BeagleSdk::send_media(const std::string& peer,
   return true;
 }
 
+BeagleStatus BeagleSdk::status() const {
+  BeagleStatus status;
+  status.ready = true;
+  return status;
+}
+
 #else
 
 extern "C" {
@@ -0,0 +1,206 @@
+#include "event_log.h"
+
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <utility>
+
+static long long now_seconds() {
+  return static_cast<long long>(std::time(nullptr));
+}
+
+void EventLog::configure(const EventLogOptions& options) {
+  std::lock_guard<std::mutex> lock(mu_);
+  options_ = options;
+  if (options_.retention_events == 0) options_.retention_events = 1;
+  if (options_.retention_sec < 0) options_.retention_sec = 0;
+  if (options_.member_ttl_sec <= 0) options_.member_ttl_sec = 30;
+  if (options_.member_expiry_sec < options_.member_ttl_sec) options_.member_expiry_sec = options_.member_ttl_sec;
+  if (options_.group_expiry_sec < options_.member_expiry_sec) options_.group_expiry_sec = options_.member_expiry_sec;
+  trim_locked(now_seconds());
+}
+
+void EventLog::push(Event ev) {
+  std::lock_guard<std::mutex> lock(mu_);
+  long long now = now_seconds();
+  Entry entry;
+  entry.event = std::move(ev);
+  entry.event.seq = next_seq_++;
+  entry.received_at = now;
+  entries_.push_back(std::move(entry));
+  trim_locked(now);
+}
+
+std::vector<Event> EventLog::read(const std::string& group_name,
+                                  const std::string& member_id,
+                                  size_t max,
+                                  EventLogStart start) {
+  std::lock_guard<std::mutex> lock(mu_);
+  long long now = now_seconds();
+  trim_locked(now);
+  expire_locked(now);
+
+  auto inserted = groups_.emplace(group_name, Group{});
+  Group& group = inserted.first->second;
+  if (inserted.second) group.cursor = start == EventLogStart::Earliest ? oldest_seq_locked() : next_seq_;
+  group.last_seen = now;
+
+  Member& member = group.members[member_id];
+  member.last_seen = now;
+  assign_locked(group, now);
+
+  std::vector<Event> out;
+  unsigned long long oldest = oldest_seq_locked();
+  while (!member.queue.empty() && (max == 0 || out.size() < max)) {
+    unsigned long long seq = member.queue.front();
+    member.queue.pop_front();
+    if (seq < oldest) {
+      group.missed++;
+      continue;
+    }
+    out.push_back(entries_[static_cast<size_t>(seq - oldest)].event);
+  }
+
+  group.delivered += out.size();
+  member.delivered += out.size();
+  return out;
+}
+
+EventLogStats EventLog::stats() {
+  std::lock_guard<std::mutex> lock(mu_);
+  long long now = now_seconds();
+  trim_locked(now);
+  expire_locked(now);
+
+  EventLogStats out;
+  out.head = next_seq_ - 1;
+  out.oldest = entries_.empty() ? 0 : entries_.front().event.seq;
+  out.retained = entries_.size();
+  unsigned long long oldest = oldest_seq_locked();
+  // Queued events may have been trimmed since they were assigned; they are
+  // counted as missed here and skipped when read.
+  auto count_live = [oldest](const std::deque<unsigned long long>& seqs, unsigned long long& missed) {
+    unsigned long long live = 0;
+    for (unsigned long long seq : seqs) {
+      if (seq >= oldest) {
+        live++;
+      } else {
+        missed++;
+      }
+    }
+    return live;
+  };
+
+  for (const auto& entry : groups_) {
+    const Group& group = entry.second;
+    ConsumerGroupStats gs;
+    gs.group = entry.first;
+    gs.last_seen_ts = group.last_seen;
+    gs.cursor = group.cursor;
+    gs.delivered = group.delivered;
+    gs.missed = group.missed;
+    gs.lag = (next_seq_ - group.cursor) + count_live(group.orphaned, gs.missed);
+    for (const auto& m : group.members) {
+      ConsumerMemberStats ms;
+      ms.id = m.first;
+      ms.active = now - m.second.last_seen <= options_.member_ttl_sec;
+      ms.last_seen_ts = m.second.last_seen;
+      ms.delivered = m.second.delivered;
+      ms.lag = count_live(m.second.queue, gs.missed);
+      gs.lag += ms.lag;
+      for (const auto& lease : group.leases) {
+        if (lease.second == m.first) ms.peers++;
+      }
+      gs.members.push_back(std::move(ms));
+    }
+    out.groups.push_back(std::move(gs));
+  }
+  return out;
+}
+
+unsigned long long EventLog::oldest_seq_locked() const {
+  return entries_.empty() ? next_seq_ : entries_.front().event.seq;
+}
+
+void EventLog::trim_locked(long long now) {
+  while (entries_.size() > options_.retention_events) entries_.pop_front();
+  if (options_.retention_sec > 0) {
+    while (!entries_.empty() && now - entries_.front().received_at > options_.retention_sec) {
+      entries_.pop_front();
+    }
+  }
+
+  // Groups that fell behind retention skip what was dropped.
+  unsigned long long oldest = oldest_seq_locked();
+  for (auto& entry : groups_) {
+    Group& group = entry.second;
+    if (group.cursor < oldest) {
+      group.missed += oldest - group.cursor;
+      group.cursor = oldest;
+    }
+  }
+}
+
+void EventLog::expire_locked(long long now) {
+  for (auto group_it = groups_.begin(); group_it != groups_.end();) {
+    Group& group = group_it->second;
+    for (auto it = group.members.begin(); it != group.members.end();) {
+      if (now - it->second.last_seen <= options_.member_expiry_sec) {
+        ++it;
+        continue;
+      }
+      group.orphaned.insert(group.orphaned.end(), it->second.queue.begin(), it->second.queue.end());
+      it = group.members.erase(it);
+    }
+    // A group outlives its members so a gateway that restarts after an
+    // outage resumes from its cursor instead of replaying or skipping.
+    if (group.members.empty() && now - group.last_seen > options_.group_expiry_sec) {
+      group_it = groups_.erase(group_it);
+    } else {
+      ++group_it;
+    }
+  }
+}
+
+void EventLog::assign_locked(Group& group, long long now) {
+  // Members that stopped polling give up their peers and queued events.
+  std::vector<std::string> active;
+  for (auto& entry : group.members) {
+    Member& member = entry.second;
+    if (now - member.last_seen <= options_.member_ttl_sec) {
+      active.push_back(entry.first);
+      continue;
+    }
+    group.orphaned.insert(group.orphaned.end(), member.queue.begin(), member.queue.end());
+    member.queue.clear();
+  }
+  for (auto it = group.leases.begin(); it != group.leases.end();) {
+    if (std::binary_search(active.begin(), active.end(), it->second)) {
+      ++it;
+    } else {
+      it = group.leases.erase(it);
+    }
+  }
+  if (active.empty()) return;
+
+  unsigned long long oldest = oldest_seq_locked();
+  auto assign = [&](unsigned long long seq) {
+    if (seq < oldest) {
+      group.missed++;
+      return;
+    }
+    const std::string& peer = entries_[static_cast<size_t>(seq - oldest)].event.peer;
+    auto lease = group.leases.find(peer);
+    if (lease == group.leases.end()) {
+      const std::string& owner = active[std::hash<std::string>{}(peer) % active.size()];
+      lease = group.leases.emplace(peer, owner).first;
+    }
+    group.members[lease->second].queue.push_back(seq);
+  };
+
+  while (!group.orphaned.empty()) {
+    assign(group.orphaned.front());
+    group.orphaned.pop_front();
+  }
+  for (; group.cursor < next_seq_; ++group.cursor) assign(group.cursor);
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct Event {
+  unsigned long long seq = 0;
+  std::string peer;
+  std::string text;
+  std::string media_url;
+  std::string media_path;
+  std::string media_type;
+  std::string filename;
+  std::string msg_id;
+  long long ts = 0;
+};
+
+// Where a group seen for the first time starts reading.
+enum class EventLogStart {
+  // Oldest retained event; suits audit consumers.
+  Earliest,
+  // Only events that arrive after the group is created.
+  Latest,
+};
+
+struct EventLogOptions {
+  // Maximum number of events kept in the log, consumed or not.
+  size_t retention_events = 10000;
+  // Events older than this are dropped; 0 disables age-based retention.
+  int retention_sec = 3600;
+  // A member that has not polled for this long loses its peers; their
+  // undelivered events move to the group's remaining members.
+  int member_ttl_sec = 30;
+  // A member that has not polled for this long is forgotten; its unread
+  // events go back to the group. Never shorter than member_ttl_sec.
+  int member_expiry_sec = 300;
+  // A group nobody has polled for this long is removed with its cursor and
+  // backlog; until then it resumes where it left off. Never shorter than
+  // member_expiry_sec.
+  int group_expiry_sec = 86400;
+};
+
+struct ConsumerMemberStats {
+  std::string id;
+  bool active = false;
+  long long last_seen_ts = 0;
+  unsigned long long delivered = 0;
+  // Events assigned to this member and not yet read by it.
+  unsigned long long lag = 0;
+  // Peers currently leased to this member.
+  size_t peers = 0;
+};
+
+struct ConsumerGroupStats {
+  std::string group;
+  long long last_seen_ts = 0;
+  // Next event not yet assigned to a member.
+  unsigned long long cursor = 0;
+  // Unassigned plus assigned-but-unread events.
+  unsigned long long lag = 0;
+  unsigned long long delivered = 0;
+  // Events trimmed by retention before this group read them.
+  unsigned long long missed = 0;
+  std::vector<ConsumerMemberStats> members;
+};
+
+struct EventLogStats {
+  unsigned long long head = 0;
+  unsigned long long oldest = 0;
+  size_t retained = 0;
+  std::vector<ConsumerGroupStats> groups;
+};
+
+// Retained inbound event log shared by named consumer groups. Each group has
+// its own cursor. Within a group every peer is leased to one active member
+// (chosen by hashing the peer), so one conversation is always handled by a
+// single member, in order. Events past the cursor are assigned to their
+// peer's member on the next poll and queued there until that member reads
+// them. A lease lasts while its member keeps polling within member_ttl_sec.
+class EventLog {
+public:
+  void configure(const EventLogOptions& options);
+
+  void push(Event ev);
+
+  // Returns the next events queued for member within group. A group seen for
+  // the first time starts at start. max == 0 means no limit.
+  std::vector<Event> read(const std::string& group,
+                          const std::string& member,
+                          size_t max,
+                          EventLogStart start);
+
+  EventLogStats stats();
+
+private:
+  struct Entry {
+    Event event;
+    long long received_at = 0;
+  };
+
+  struct Member {
+    long long last_seen = 0;
+    unsigned long long delivered = 0;
+    // Sequence numbers assigned to this member, in per-peer order.
+    std::deque<unsigned long long> queue;
+  };
+
+  struct Group {
+    long long last_seen = 0;
+    unsigned long long cursor = 0;
+    unsigned long long delivered = 0;
+    unsigned long long missed = 0;
+    std::map<std::string, Member> members;
+    // peer -> member id.
+    std::map<std::string, std::string> leases;
+    // Events taken back from members that stopped polling; reassigned
+    // before anything past the cursor.
+    std::deque<unsigned long long> orphaned;
+  };
+
+  unsigned long long oldest_seq_locked() const;
+  void trim_locked(long long now);
+  void expire_locked(long long now);
+  void assign_locked(Group& group, long long now);
+
+  EventLogOptions options_;
+  std::mutex mu_;
+  std::deque<Entry> entries_;
+  unsigned long long next_seq_ = 1;
+  std::map<std::string, Group> groups_;
+};
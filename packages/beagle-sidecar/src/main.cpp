@@ -1,4 +1,6 @@
 #include "beagle_sdk.h"
+#include "event_log.h"
+#include "stream_coalescer.h"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -6,28 +8,17 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
-#include <mutex>
 #include <sstream>
 #include <string>
 #include <thread>
 #include <vector>
 
-struct Event {
-  std::string peer;
-  std::string text;
-  std::string media_url;
-  std::string media_path;
-  std::string media_type;
-  std::string filename;
-  std::string msg_id;
-  long long ts = 0;
-};
-
-static std::mutex g_events_mu;
-static std::vector<Event> g_events;
+static EventLog g_event_log;
 
 static bool extract_json_string(const std::string& body, const std::string& key, std::string& out) {
   std::string needle = "\"" + key + "\"";
@@ -37,10 +28,76 @@ static bool extract_json_string(const std::string& body, const std::string& key,
   if (pos == std::string::npos) return false;
   pos = body.find('"', pos);
   if (pos == std::string::npos) return false;
-  size_t end = body.find('"', pos + 1);
-  if (end == std::string::npos) return false;
-  out = body.substr(pos + 1, end - pos - 1);
-  return true;
+  // Unescape as we go: streamed chunks routinely carry quotes and newlines.
+  std::string value;
+  for (size_t i = pos + 1; i < body.size(); ++i) {
+    char c = body[i];
+    if (c == '"') {
+      out = value;
+      return true;
+    }
+    if (c != '\\' || i + 1 >= body.size()) {
+      value += c;
+      continue;
+    }
+    char e = body[++i];
+    switch (e) {
+      case 'n': value += '\n'; break;
+      case 'r': value += '\r'; break;
+      case 't': value += '\t'; break;
+      case 'b': value += '\b'; break;
+      case 'f': value += '\f'; break;
+      case 'u': {
+        if (i + 4 >= body.size()) return false;
+        unsigned long cp = std::strtoul(body.substr(i + 1, 4).c_str(), nullptr, 16);
+        i += 4;
+        if (cp >= 0xD800 && cp <= 0xDBFF && i + 6 < body.size() && body[i + 1] == '\\' && body[i + 2] == 'u') {
+          unsigned long lo = std::strtoul(body.substr(i + 3, 4).c_str(), nullptr, 16);
+          if (lo >= 0xDC00 && lo <= 0xDFFF) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            i += 6;
+          }
+        }
+        if (cp < 0x80) {
+          value += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+          value += static_cast<char>(0xC0 | (cp >> 6));
+          value += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+          value += static_cast<char>(0xE0 | (cp >> 12));
+          value += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+          value += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+          value += static_cast<char>(0xF0 | (cp >> 18));
+          value += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+          value += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+          value += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+        break;
+      }
+      default: value += e; break;
+    }
+  }
+  return false;
+}
+
+static bool extract_json_bool(const std::string& body, const std::string& key, bool& out) {
+  std::string needle = "\"" + key + "\"";
+  size_t pos = body.find(needle);
+  if (pos == std::string::npos) return false;
+  pos = body.find(':', pos + needle.size());
+  if (pos == std::string::npos) return false;
+  pos++;
+  while (pos < body.size() && (body[pos] == ' ' || body[pos] == '\t')) pos++;
+  if (body.compare(pos, 4, "true") == 0) {
+    out = true;
+    return true;
+  }
+  if (body.compare(pos, 5, "false") == 0) {
+    out = false;
+    return true;
+  }
+  return false;
 }
 
 static std::string json_escape(const std::string& in) {
@@ -59,14 +116,15 @@ static std::string json_escape(const std::string& in) {
   return out;
 }
 
-static std::string events_to_json(std::vector<Event> events) {
+static std::string events_to_json(const std::vector<Event>& events) {
   std::ostringstream oss;
   oss << "[";
   for (size_t i = 0; i < events.size(); ++i) {
     const auto& ev = events[i];
     if (i) oss << ",";
     oss << "{"
-        << "\"peer\":\"" << json_escape(ev.peer) << "\"";
+        << "\"seq\":" << ev.seq
+        << ",\"peer\":\"" << json_escape(ev.peer) << "\"";
     if (!ev.text.empty()) oss << ",\"text\":\"" << json_escape(ev.text) << "\"";
     if (!ev.media_url.empty()) oss << ",\"mediaUrl\":\"" << json_escape(ev.media_url) << "\"";
     if (!ev.media_path.empty()) oss << ",\"mediaPath\":\"" << json_escape(ev.media_path) << "\"";
@@ -80,6 +138,90 @@ static std::string events_to_json(std::vector<Event> events) {
   return oss.str();
 }
 
+static std::string url_decode(const std::string& in) {
+  std::string out;
+  out.reserve(in.size());
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (in[i] == '+') {
+      out += ' ';
+    } else if (in[i] == '%' && i + 2 < in.size()) {
+      out += static_cast<char>(std::strtol(in.substr(i + 1, 2).c_str(), nullptr, 16));
+      i += 2;
+    } else {
+      out += in[i];
+    }
+  }
+  return out;
+}
+
+static std::string query_param(const std::string& query, const std::string& key) {
+  size_t pos = 0;
+  while (pos <= query.size()) {
+    size_t end = query.find('&', pos);
+    if (end == std::string::npos) end = query.size();
+    std::string pair = query.substr(pos, end - pos);
+    size_t eq = pair.find('=');
+    if (url_decode(pair.substr(0, eq)) == key) {
+      return eq == std::string::npos ? std::string() : url_decode(pair.substr(eq + 1));
+    }
+    pos = end + 1;
+  }
+  return "";
+}
+
+// Parses a non-negative decimal; an empty string means 0. Rejects signs,
+// trailing junk and values that do not fit, which strtoul alone accepts.
+static bool parse_size(const std::string& in, size_t& out) {
+  out = 0;
+  if (in.empty()) return true;
+  for (char c : in) {
+    if (c < '0' || c > '9') return false;
+  }
+  errno = 0;
+  char* end = nullptr;
+  unsigned long value = std::strtoul(in.c_str(), &end, 10);
+  if (errno == ERANGE || *end != '\0') return false;
+  out = static_cast<size_t>(value);
+  return true;
+}
+
+static std::string consumers_to_json(const EventLogStats& stats) {
+  std::ostringstream oss;
+  oss << "{"
+      << "\"ok\":true"
+      << ",\"head\":" << stats.head
+      << ",\"oldest\":" << stats.oldest
+      << ",\"retained\":" << stats.retained
+      << ",\"groups\":[";
+  for (size_t i = 0; i < stats.groups.size(); ++i) {
+    const auto& group = stats.groups[i];
+    if (i) oss << ",";
+    oss << "{"
+        << "\"group\":\"" << json_escape(group.group) << "\""
+        << ",\"lastSeenTs\":" << group.last_seen_ts
+        << ",\"cursor\":" << group.cursor
+        << ",\"lag\":" << group.lag
+        << ",\"delivered\":" << group.delivered
+        << ",\"missed\":" << group.missed
+        << ",\"members\":[";
+    for (size_t j = 0; j < group.members.size(); ++j) {
+      const auto& member = group.members[j];
+      if (j) oss << ",";
+      oss << "{"
+          << "\"id\":\"" << json_escape(member.id) << "\""
+          << ",\"active\":" << (member.active ? "true" : "false")
+          << ",\"lastSeenTs\":" << member.last_seen_ts
+          << ",\"delivered\":" << member.delivered
+          << ",\"lag\":" << member.lag
+          << ",\"peers\":" << member.peers
+          << "}";
+    }
+    oss << "]}";
+  }
+  oss << "]}";
+  return oss.str();
+}
+
 static std::string read_until(int fd, const std::string& marker) {
   std::string data;
   char buf[4096];
@@ -145,8 +287,7 @@ static void push_event(const BeagleIncomingMessage& msg) {
   ev.msg_id = msg.msg_id;
   ev.ts = msg.ts;
 
-  std::lock_guard<std::mutex> lock(g_events_mu);
-  g_events.push_back(std::move(ev));
+  g_event_log.push(std::move(ev));
 }
 
 struct ServerOptions {
@@ -154,8 +295,32 @@ struct ServerOptions {
   std::string token;
   std::string data_dir = "./data";
   std::string config_path;
+  StreamCoalescerOptions stream;
+  EventLogOptions events;
+  std::string error;
 };
 
+// Numeric flags go through parse_size so negative or junk values are
+// rejected instead of wrapping around to huge limits.
+static bool parse_size_arg(const std::string& flag, const char* value, size_t min, size_t max,
+                           size_t& out, std::string& error) {
+  size_t parsed = 0;
+  if (!*value || !parse_size(value, parsed) || parsed < min || parsed > max) {
+    error = "Invalid value for " + flag + ": " + value + " (expected " + std::to_string(min) +
+            ".." + std::to_string(max) + ")";
+    return false;
+  }
+  out = parsed;
+  return true;
+}
+
+static bool parse_int_arg(const std::string& flag, const char* value, int min, int& out, std::string& error) {
+  size_t parsed = 0;
+  if (!parse_size_arg(flag, value, static_cast<size_t>(min), INT_MAX, parsed, error)) return false;
+  out = static_cast<int>(parsed);
+  return true;
+}
+
 static ServerOptions parse_args(int argc, char** argv) {
   ServerOptions opts;
   for (int i = 1; i < argc; ++i) {
@@ -168,6 +333,23 @@ static ServerOptions parse_args(int argc, char** argv) {
       opts.data_dir = argv[++i];
     } else if (arg == "--config" && i + 1 < argc) {
       opts.config_path = argv[++i];
+    } else if (arg == "--stream-delay-ms" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 0, opts.stream.delay_ms, opts.error)) break;
+    } else if (arg == "--stream-max-bytes" && i + 1 < argc) {
+      // Bounded well below SIZE_MAX so the size trigger always stays active.
+      if (!parse_size_arg(arg, argv[++i], 1, 1024 * 1024, opts.stream.max_bytes, opts.error)) break;
+    } else if (arg == "--stream-idle-ms" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 1, opts.stream.idle_ms, opts.error)) break;
+    } else if (arg == "--events-retention" && i + 1 < argc) {
+      if (!parse_size_arg(arg, argv[++i], 1, 10000000, opts.events.retention_events, opts.error)) break;
+    } else if (arg == "--events-retention-sec" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 0, opts.events.retention_sec, opts.error)) break;
+    } else if (arg == "--consumer-ttl-sec" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 1, opts.events.member_ttl_sec, opts.error)) break;
+    } else if (arg == "--consumer-expiry-sec" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 1, opts.events.member_expiry_sec, opts.error)) break;
+    } else if (arg == "--consumer-group-expiry-sec" && i + 1 < argc) {
+      if (!parse_int_arg(arg, argv[++i], 1, opts.events.group_expiry_sec, opts.error)) break;
     }
   }
   return opts;
@@ -201,18 +383,29 @@ static std::string resolve_config_path(const ServerOptions& opts) {
 
 int main(int argc, char** argv) {
   ServerOptions opts = parse_args(argc, argv);
+  if (!opts.error.empty()) {
+    std::cerr << opts.error << "\n";
+    return 1;
+  }
   std::string config_path = resolve_config_path(opts);
   if (config_path.empty()) {
     std::cerr << "Missing Carrier config. Provide --config or set BEAGLE_SDK_ROOT.\n";
     return 1;
   }
 
+  g_event_log.configure(opts.events);
+
   BeagleSdk sdk;
   if (!sdk.start({config_path, opts.data_dir}, push_event)) {
     std::cerr << "Failed to start Beagle SDK\n";
     return 1;
   }
 
+  StreamCoalescer streams;
+  streams.start(opts.stream, [&sdk](const std::string& peer, const std::string& text) {
+    return sdk.send_text(peer, text);
+  });
+
   int server_fd = socket(AF_INET, SOCK_STREAM, 0);
   if (server_fd < 0) {
     std::cerr << "Failed to create socket\n";
@@ -264,6 +457,13 @@ int main(int argc, char** argv) {
     std::string path;
     line_stream >> method >> path;
 
+    std::string query;
+    size_t query_pos = path.find('?');
+    if (query_pos != std::string::npos) {
+      query = path.substr(query_pos + 1);
+      path.resize(query_pos);
+    }
+
     if (!opts.token.empty()) {
       std::string auth = header_value(headers, "Authorization");
       std::string expected = "Bearer " + opts.token;
@@ -301,12 +501,27 @@ int main(int argc, char** argv) {
           << "}";
       send_response(client_fd, 200, "application/json", oss.str());
     } else if (method == "GET" && path == "/events") {
-      std::vector<Event> events;
-      {
-        std::lock_guard<std::mutex> lock(g_events_mu);
-        events.swap(g_events);
+      std::string group = query_param(query, "group");
+      std::string member = query_param(query, "member");
+      size_t max = 0;
+      bool max_ok = parse_size(query_param(query, "max"), max);
+      std::string from = query_param(query, "from");
+      if (group.empty()) group = "default";
+      // The default group keeps the original buffering semantics; other
+      // groups skip history unless asked, so a new gateway group does not
+      // replay old messages into the agent.
+      if (from.empty()) from = group == "default" ? "earliest" : "latest";
+      if (!max_ok) {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"invalid_max\"}");
+      } else if (from != "earliest" && from != "latest") {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"invalid_from\"}");
+      } else {
+        EventLogStart start = from == "earliest" ? EventLogStart::Earliest : EventLogStart::Latest;
+        std::vector<Event> events = g_event_log.read(group, member, max, start);
+        send_response(client_fd, 200, "application/json", events_to_json(events));
       }
-      send_response(client_fd, 200, "application/json", events_to_json(std::move(events)));
+    } else if (method == "GET" && path == "/consumers") {
+      send_response(client_fd, 200, "application/json", consumers_to_json(g_event_log.stats()));
     } else if (method == "POST" && path == "/sendText") {
       std::string peer;
       std::string text;
@@ -315,6 +530,42 @@ int main(int argc, char** argv) {
 
       bool ok = sdk.send_text(peer, text);
       send_response(client_fd, ok ? 200 : 500, "application/json", ok ? "{\"ok\":true}" : "{\"ok\":false}");
+    } else if (method == "POST" && path == "/sendStream") {
+      std::string stream_id;
+      std::string peer;
+      std::string text;
+      bool final = false;
+      extract_json_string(body, "streamId", stream_id);
+      extract_json_string(body, "peer", peer);
+      extract_json_string(body, "text", text);
+      extract_json_bool(body, "final", final);
+
+      if (stream_id.empty() && peer.empty()) {
+        send_response(client_fd, 400, "application/json", "{\"ok\":false,\"error\":\"missing_peer\"}");
+      } else {
+        StreamAppendResult result = streams.append(stream_id, peer, text, final);
+        std::ostringstream oss;
+        int code = 200;
+        switch (result) {
+          case StreamAppendResult::Ok:
+            oss << "{\"ok\":true,\"streamId\":\"" << json_escape(stream_id) << "\",\"delivered\":true}";
+            break;
+          case StreamAppendResult::SendFailed:
+            // The chunk was accepted and buffered text is being retried, so
+            // this is not a request failure; the client must not resend.
+            oss << "{\"ok\":true,\"streamId\":\"" << json_escape(stream_id) << "\",\"delivered\":false}";
+            break;
+          case StreamAppendResult::UnknownStream:
+            code = 404;
+            oss << "{\"ok\":false,\"error\":\"unknown_stream\"}";
+            break;
+          case StreamAppendResult::PeerMismatch:
+            code = 400;
+            oss << "{\"ok\":false,\"error\":\"peer_mismatch\"}";
+            break;
+        }
+        send_response(client_fd, code, "application/json", oss.str());
+      }
     } else if (method == "POST" && path == "/sendMedia") {
       std::string peer;
       std::string caption;
@@ -338,6 +589,7 @@ int main(int argc, char** argv) {
     close(client_fd);
   }
 
+  streams.stop();
   sdk.stop();
   return 0;
 }
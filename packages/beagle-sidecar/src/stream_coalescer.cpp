@@ -0,0 +1,259 @@
+#include "stream_coalescer.h"
+
+#include <cstdint>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace {
+// Decodes the UTF-8 sequence starting at text[i]. Returns its length, or 0
+// if the sequence is cut off at the end of the buffer. Invalid bytes are
+// treated as one-byte sequences.
+size_t utf8_next(const std::string& text, size_t i, uint32_t& cp) {
+  unsigned char c = static_cast<unsigned char>(text[i]);
+  size_t len = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xE ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+  if (i + len > text.size()) return 0;
+  if (len == 1) {
+    cp = c;
+    return 1;
+  }
+  cp = c & (0x7F >> len);
+  for (size_t k = 1; k < len; ++k) cp = (cp << 6) | (static_cast<unsigned char>(text[i + k]) & 0x3F);
+  return len;
+}
+
+bool is_space(uint32_t cp) {
+  return cp == ' ' || cp == '\t' || cp == '\r' || cp == '\n' || cp == 0x3000;
+}
+
+// CJK symbols and punctuation, fullwidth punctuation and the ellipsis.
+bool is_wide_punct(uint32_t cp) {
+  return (cp >= 0x3001 && cp <= 0x303F) || (cp >= 0xFF01 && cp <= 0xFF0F) ||
+         (cp >= 0xFF1A && cp <= 0xFF20) || cp == 0x2026;
+}
+
+// Ideographs and kana: scripts written without spaces, where every
+// character ends a word for flushing purposes.
+bool is_cjk(uint32_t cp) {
+  return (cp >= 0x2E80 && cp <= 0x2FFF) || (cp >= 0x3040 && cp <= 0x9FFF) ||
+         (cp >= 0xF900 && cp <= 0xFAFF) || (cp >= 0x20000 && cp <= 0x3FFFF);
+}
+
+bool is_filler(uint32_t cp) {
+  if (cp < 0x80) return !((cp >= '0' && cp <= '9') || (cp >= 'a' && cp <= 'z') || (cp >= 'A' && cp <= 'Z'));
+  return is_space(cp) || is_wide_punct(cp);
+}
+
+// Number of leading bytes of pending a delay-triggered flush may send: up to
+// the last word boundary (whitespace, CJK punctuation or a CJK character),
+// and only if that prefix has something besides whitespace and punctuation.
+size_t partial_cut(const std::string& pending) {
+  size_t cut = 0;
+  bool content = false;
+  uint32_t cp = 0;
+  for (size_t i = 0; i < pending.size();) {
+    size_t len = utf8_next(pending, i, cp);
+    if (len == 0) break;
+    i += len;
+    if (!is_filler(cp)) content = true;
+    if (content && (is_space(cp) || is_wide_punct(cp) || is_cjk(cp))) cut = i;
+  }
+  return cut;
+}
+
+bool is_blank(const std::string& text) {
+  return text.find_first_not_of(" \t\r\n") == std::string::npos;
+}
+} // namespace
+
+StreamCoalescer::~StreamCoalescer() {
+  stop();
+}
+
+void StreamCoalescer::start(const StreamCoalescerOptions& options, StreamSendFn send) {
+  options_ = options;
+  if (options_.delay_ms < 0) options_.delay_ms = 0;
+  if (options_.max_bytes == 0) options_.max_bytes = 1;
+  if (options_.idle_ms <= 0) options_.idle_ms = 30000;
+  send_ = std::move(send);
+  stopping_ = false;
+  thread_ = std::thread([this]() { run(); });
+}
+
+void StreamCoalescer::stop() {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!thread_.joinable()) return;
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  thread_.join();
+
+  // Deliver whatever is still buffered rather than dropping partial answers.
+  std::vector<std::string> ids;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (const auto& entry : sessions_) ids.push_back(entry.first);
+  }
+  for (const auto& id : ids) flush(id, FlushMode::Final);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  for (const auto& entry : sessions_) {
+    std::cerr << "[stream] dropping " << entry.second.pending.size()
+              << " undelivered bytes on shutdown. stream=" << entry.first << "\n";
+  }
+  sessions_.clear();
+}
+
+StreamAppendResult StreamCoalescer::append(std::string& stream_id,
+                                           const std::string& peer,
+                                           const std::string& text,
+                                           bool final) {
+  bool need_flush = false;
+  bool failed = false;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    Clock::time_point now = Clock::now();
+    Session* session = nullptr;
+    if (stream_id.empty()) {
+      long long epoch_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      stream_id = std::to_string(epoch_ms) + "-" + std::to_string(next_id_++);
+      session = &sessions_[stream_id];
+      session->peer = peer;
+    } else {
+      auto it = sessions_.find(stream_id);
+      if (it == sessions_.end() || it->second.closing) return StreamAppendResult::UnknownStream;
+      session = &it->second;
+      if (!peer.empty() && peer != session->peer) return StreamAppendResult::PeerMismatch;
+    }
+
+    if (session->pending.empty() && !text.empty()) session->first_pending_at = now;
+    session->pending += text;
+    session->last_activity_at = now;
+    failed = session->failed;
+    need_flush = final || session->pending.size() >= options_.max_bytes;
+  }
+  cv_.notify_one();
+
+  if (need_flush && !flush(stream_id, final ? FlushMode::Final : FlushMode::Partial)) failed = true;
+  return failed ? StreamAppendResult::SendFailed : StreamAppendResult::Ok;
+}
+
+size_t StreamCoalescer::active_streams() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return sessions_.size();
+}
+
+bool StreamCoalescer::flush(const std::string& stream_id, FlushMode mode) {
+  std::lock_guard<std::mutex> send_lock(send_mu_);
+
+  std::string peer;
+  std::string text;
+  bool closing = false;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = sessions_.find(stream_id);
+    if (it == sessions_.end()) return true;
+    Session& session = it->second;
+    Clock::time_point now = Clock::now();
+    // An append may have landed between the idle scan and this flush.
+    if (mode == FlushMode::Idle && now - session.last_activity_at < std::chrono::milliseconds(options_.idle_ms)) {
+      return true;
+    }
+    if (mode == FlushMode::Final) session.closing = true;
+    closing = session.closing || mode == FlushMode::Idle;
+
+    size_t cut = session.pending.size();
+    if (!closing && cut < options_.max_bytes) cut = partial_cut(session.pending);
+    peer = session.peer;
+    text = session.pending.substr(0, cut);
+    session.pending.erase(0, cut);
+    // Trailing whitespace of a finished reply is not worth a message.
+    if (closing && is_blank(text)) text.clear();
+    if (!session.pending.empty()) session.first_pending_at = now;
+  }
+
+  bool ok = text.empty() || send_(peer, text);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  auto it = sessions_.find(stream_id);
+  if (it == sessions_.end()) return ok;
+  Session& session = it->second;
+  Clock::time_point now = Clock::now();
+  if (ok) {
+    session.failed = false;
+    bool still_idle = now - session.last_activity_at >= std::chrono::milliseconds(options_.idle_ms);
+    if (closing && session.pending.empty() && (session.closing || still_idle)) sessions_.erase(it);
+    return true;
+  }
+
+  std::cerr << "[stream] flush failed; will retry. stream=" << stream_id << " peer=" << peer << "\n";
+  session.pending.insert(0, text);
+  session.first_pending_at = now;
+  session.retry_at = now + std::chrono::milliseconds(options_.delay_ms > 50 ? options_.delay_ms : 50);
+  session.failed = true;
+  if (closing && now - session.last_activity_at >= std::chrono::milliseconds(options_.idle_ms) * 2) {
+    std::cerr << "[stream] giving up; dropping " << session.pending.size()
+              << " undelivered bytes. stream=" << stream_id << "\n";
+    sessions_.erase(it);
+  }
+  return false;
+}
+
+void StreamCoalescer::run() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (!stopping_) {
+    Clock::time_point now = Clock::now();
+    Clock::time_point next = Clock::time_point::max();
+    std::vector<std::pair<std::string, FlushMode>> due;
+
+    for (const auto& entry : sessions_) {
+      const Session& session = entry.second;
+      if (session.failed && now < session.retry_at) {
+        if (session.retry_at < next) next = session.retry_at;
+        continue;
+      }
+      if (session.closing) {
+        due.emplace_back(entry.first, FlushMode::Final);
+        continue;
+      }
+      Clock::time_point idle_at = session.last_activity_at + std::chrono::milliseconds(options_.idle_ms);
+      if (now >= idle_at) {
+        due.emplace_back(entry.first, FlushMode::Idle);
+        continue;
+      }
+      if (idle_at < next) next = idle_at;
+      if (session.pending.empty()) continue;
+      if (session.pending.size() >= options_.max_bytes) {
+        due.emplace_back(entry.first, FlushMode::Partial);
+        continue;
+      }
+      // Without a word boundary there is nothing to send until more text
+      // arrives (append wakes us) or the stream ends.
+      if (partial_cut(session.pending) == 0) continue;
+      Clock::time_point flush_at = session.first_pending_at + std::chrono::milliseconds(options_.delay_ms);
+      if (now >= flush_at) {
+        due.emplace_back(entry.first, FlushMode::Partial);
+      } else if (flush_at < next) {
+        next = flush_at;
+      }
+    }
+
+    if (!due.empty()) {
+      lock.unlock();
+      for (const auto& item : due) {
+        if (item.second == FlushMode::Idle) std::cerr << "[stream] stream " << item.first << " idle; finalizing\n";
+        flush(item.first, item.second);
+      }
+      lock.lock();
+      continue;
+    }
+
+    if (next == Clock::time_point::max()) {
+      cv_.wait(lock);
+    } else {
+      cv_.wait_until(lock, next);
+    }
+  }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct StreamCoalescerOptions {
+  // How long buffered chunks may wait before they are flushed as one message.
+  int delay_ms = 250;
+  // Flush as soon as this many bytes are buffered, regardless of delay.
+  size_t max_bytes = 1024;
+  // Streams without activity for this long are flushed and finalized.
+  int idle_ms = 30000;
+};
+
+using StreamSendFn = std::function<bool(const std::string& peer, const std::string& text)>;
+
+enum class StreamAppendResult {
+  Ok,
+  SendFailed,
+  UnknownStream,
+  PeerMismatch,
+};
+
+// Coalesces incremental text chunks (e.g. LLM tokens) into a small number of
+// outbound messages, Nagle-style: chunks are buffered per stream and flushed
+// when the buffer reaches max_bytes, when the oldest buffered chunk is older
+// than delay_ms, or when the stream is finalized. Delay-triggered flushes stop
+// at the last word boundary (whitespace, CJK punctuation, or any CJK
+// character, since those scripts use no spaces) and never send a fragment of
+// only whitespace and punctuation. Failed sends keep their text buffered and
+// are retried after delay_ms.
+class StreamCoalescer {
+public:
+  ~StreamCoalescer();
+
+  void start(const StreamCoalescerOptions& options, StreamSendFn send);
+  void stop();
+
+  // Appends a chunk to the stream identified by stream_id. An empty stream_id
+  // opens a new stream and is filled in with the generated id. When final is
+  // set, any buffered text is flushed and the stream is closed. SendFailed
+  // means buffered text of this stream could not be delivered yet; the chunk
+  // itself was accepted and delivery is retried, so callers report it as
+  // pending rather than as an error.
+  StreamAppendResult append(std::string& stream_id,
+                            const std::string& peer,
+                            const std::string& text,
+                            bool final);
+
+  size_t active_streams() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Session {
+    std::string peer;
+    std::string pending;
+    Clock::time_point first_pending_at;
+    Clock::time_point last_activity_at;
+    Clock::time_point retry_at;
+    bool failed = false;
+    // Set once final was requested; no more chunks are accepted.
+    bool closing = false;
+  };
+
+  enum class FlushMode {
+    // Send up to the last word boundary, or everything once max_bytes is reached.
+    Partial,
+    // Send everything and close the stream.
+    Final,
+    // Like Final, but only if the stream is still idle when the flush runs.
+    Idle,
+  };
+
+  bool flush(const std::string& stream_id, FlushMode mode);
+  void run();
+
+  StreamCoalescerOptions options_;
+  StreamSendFn send_;
+
+  mutable std::mutex mu_;
+  // Serializes sends so flushes of one stream reach the peer in order even
+  // when the HTTP thread and the flusher thread race.
+  std::mutex send_mu_;
+  std::condition_variable cv_;
+  std::map<std::string, Session> sessions_;
+  unsigned long long next_id_ = 1;
+  bool stopping_ = false;
+  std::thread thread_;
+};